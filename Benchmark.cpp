@@ -0,0 +1,303 @@
+//Measures DiskMultiMap and IntelWeb performance on synthetic telemetry and prints one JSON object per line,
+//so results from different runs can be collected and compared over time.
+//
+//  make benchmark SKELETON_DIR=/path/to/skeleton
+//  ./benchmark [--sizes 1000,10000] [--bucket-factors 0.25,1,4] [--crawls 200] [--threshold 10]
+//              [--seed 1] [--dir .] [--out results.jsonl]
+//
+//For every data size and bucket factor (buckets = data size * factor) it reports:
+//  diskmultimap: insert, search and erase throughput, disk reads and writes per operation, chain lengths and file size
+//  intelweb: ingest throughput, crawl latency percentiles, disk I/O, prevalence check cost and the total file size
+//I/O counts come from the stats() API and read as zero when built with -DCYBERSPIDER_NO_STATS.
+
+#include "DiskMultiMap.h"
+#include "IntelWeb.h"
+#include "TelemetryGenerator.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+using namespace std;
+
+namespace
+{
+    struct BenchmarkOptions
+    {
+        vector<unsigned int> sizes = {1000, 10000};
+        vector<double> bucketFactors = {0.25, 1, 4};
+        unsigned int numCrawls = 200;
+        unsigned int threshold = 10;
+        unsigned int seed = 1;
+        string directory = ".";
+        string outputFile; //empty means standard output
+    };
+
+    typedef chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    double perSecond(double count, double seconds)
+    {
+        return seconds > 0 ? count / seconds : 0;
+    }
+
+    long fileSize(const string& filename)
+    {
+        ifstream inf(filename, ios::binary | ios::ate);
+        if (!inf)
+            return 0;
+        return static_cast<long>(inf.tellg());
+    }
+
+    double percentile(const vector<double>& sorted, double p) //nearest rank percentile, expects the values to already be sorted
+    {
+        if (sorted.empty())
+            return 0;
+        double rank = ceil(p / 100 * sorted.size()) - 1; //the smallest value with at least p percent of the samples at or below it
+        if (rank < 0)
+            rank = 0;
+        if (rank > sorted.size() - 1)
+            rank = sorted.size() - 1;
+        return sorted[static_cast<size_t>(rank)];
+    }
+
+    template <typename T>
+    vector<T> parseList(const string& text)
+    {
+        vector<T> values;
+        istringstream iss(text);
+        string item;
+        while (getline(iss, item, ','))
+        {
+            istringstream itemStream(item);
+            T value;
+            if (itemStream >> value)
+                values.push_back(value);
+        }
+        return values;
+    }
+
+    bool parseOptions(int argc, char* argv[], BenchmarkOptions& options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string flag = argv[i];
+            if (i + 1 >= argc)
+                return false;
+            string value = argv[++i];
+            if (flag == "--sizes")
+                options.sizes = parseList<unsigned int>(value);
+            else if (flag == "--bucket-factors")
+                options.bucketFactors = parseList<double>(value);
+            else if (flag == "--crawls")
+                options.numCrawls = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+            else if (flag == "--threshold")
+                options.threshold = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+            else if (flag == "--seed")
+                options.seed = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+            else if (flag == "--dir")
+                options.directory = value;
+            else if (flag == "--out")
+                options.outputFile = value;
+            else
+                return false;
+        }
+        return !options.sizes.empty() && !options.bucketFactors.empty();
+    }
+
+    TelemetryGenerator makeGenerator(unsigned int size, unsigned int seed) //same proportions as GenerateTelemetry
+    {
+        return TelemetryGenerator(size/50 + 1, size/4 + 1, size/10 + 1, seed);
+    }
+
+    unsigned int bucketsFor(unsigned int size, double factor)
+    {
+        unsigned int buckets = static_cast<unsigned int>(size * factor);
+        return buckets > 0 ? buckets : 1;
+    }
+
+    void benchmarkDiskMultiMap(const BenchmarkOptions& options, unsigned int size, double factor, ostream& out)
+    {
+        TelemetryGenerator generator = makeGenerator(size, options.seed);
+        vector<MultiMapTuple> tuples(size);
+        for (MultiMapTuple& t : tuples)
+            generator.nextLine(t.context, t.key, t.value);
+
+        string filename = options.directory + "/bench.diskmultimap";
+        unsigned int buckets = bucketsFor(size, factor);
+        DiskMultiMap map;
+        if (!map.createNew(filename, buckets))
+        {
+            cerr << "Cannot create " << filename << endl;
+            return;
+        }
+
+        Clock::time_point start = Clock::now();
+        for (const MultiMapTuple& t : tuples)
+            map.insert(t.key, t.value, t.context);
+        double insertSeconds = secondsSince(start);
+
+        unsigned long long found = 0;
+        start = Clock::now();
+        for (const MultiMapTuple& t : tuples) //walk every association for each key so the whole chain is read
+        {
+            for (DiskMultiMap::Iterator it = map.search(t.key); it.isValid(); ++it)
+                found++;
+        }
+        double searchSeconds = secondsSince(start);
+        DiskMultiMap::Stats loaded = map.stats(true); //bucket occupancy while the map is full
+
+        map.close(); //writes the header so the file size is final
+        long bytes = fileSize(filename);
+        map.openExisting(filename);
+
+        unsigned long long erased = 0;
+        start = Clock::now();
+        for (const MultiMapTuple& t : tuples)
+            erased += map.erase(t.key, t.value, t.context);
+        double eraseSeconds = secondsSince(start);
+        DiskMultiMap::Stats counters = map.stats();
+        map.close();
+        remove(filename.c_str());
+
+        out << "{\"benchmark\":\"diskmultimap\""
+            << ",\"items\":" << size
+            << ",\"buckets\":" << buckets
+            << ",\"insert_ops_per_sec\":" << perSecond(size, insertSeconds)
+            << ",\"search_ops_per_sec\":" << perSecond(size, searchSeconds)
+            << ",\"erase_ops_per_sec\":" << perSecond(size, eraseSeconds)
+            << ",\"associations_found\":" << found
+            << ",\"associations_erased\":" << erased
+            << ",\"insert_disk_reads\":" << counters.operations[DiskMultiMap::Insert].diskReads
+            << ",\"insert_disk_writes\":" << counters.operations[DiskMultiMap::Insert].diskWrites
+            << ",\"search_disk_reads\":" << counters.operations[DiskMultiMap::Search].diskReads
+            << ",\"erase_disk_reads\":" << counters.operations[DiskMultiMap::Erase].diskReads
+            << ",\"erase_disk_writes\":" << counters.operations[DiskMultiMap::Erase].diskWrites
+            << ",\"search_chain_length_mean\":" << counters.searchChainLength.mean()
+            << ",\"search_chain_length_max\":" << counters.searchChainLength.max
+            << ",\"bucket_occupancy_max\":" << loaded.bucketOccupancy.max
+            << ",\"empty_buckets\":" << loaded.bucketOccupancy.buckets[0]
+            << ",\"free_list_length\":" << counters.freeListLength
+            << ",\"file_bytes\":" << bytes
+            << "}" << endl;
+    }
+
+    void benchmarkIntelWeb(const BenchmarkOptions& options, unsigned int size, double factor, ostream& out)
+    {
+        TelemetryGenerator generator = makeGenerator(size, options.seed);
+        string telemetryFile = options.directory + "/bench.telemetry.txt";
+        if (!generator.generate(telemetryFile, size))
+        {
+            cerr << "Cannot write " << telemetryFile << endl;
+            return;
+        }
+
+        string prefix = options.directory + "/bench.intelweb";
+        unsigned int maxDataItems = (bucketsFor(size, factor) + 1) / 2; //IntelWeb gives each map twice this many buckets
+        IntelWeb web;
+        if (!web.createNew(prefix, maxDataItems))
+        {
+            cerr << "Cannot create " << prefix << endl;
+            return;
+        }
+
+        Clock::time_point start = Clock::now();
+        web.ingest(telemetryFile);
+        double ingestSeconds = secondsSince(start);
+
+        vector<double> crawlMicroseconds;
+        unsigned long long badEntities = 0;
+        vector<string> badEntitiesFound;
+        vector<InteractionTuple> interactions;
+        for (unsigned int i = 0; i < options.numCrawls; i++)
+        {
+            vector<string> indicators(1, generator.randomFile());
+            start = Clock::now();
+            badEntities += web.crawl(indicators, options.threshold, badEntitiesFound, interactions);
+            crawlMicroseconds.push_back(secondsSince(start) * 1e6);
+        }
+        sort(crawlMicroseconds.begin(), crawlMicroseconds.end());
+        IntelWeb::Stats counters = web.stats();
+        unsigned long long diskReads = 0, diskWrites = 0;
+        for (const DiskMultiMap::Stats* mapStats : {&counters.sourceToDestination, &counters.destinationToSource})
+        {
+            for (const DiskMultiMap::OperationStats& op : mapStats->operations)
+            {
+                diskReads += op.diskReads;
+                diskWrites += op.diskWrites;
+            }
+        }
+
+        web.close();
+        const char* suffixes[] = {".sourceToDestination", ".destinationToSource", ".prevalenceSketch"};
+        long bytes = 0;
+        for (const char* suffix : suffixes)
+        {
+            bytes += fileSize(prefix + suffix);
+            remove((prefix + suffix).c_str());
+        }
+        remove(telemetryFile.c_str());
+
+        out << "{\"benchmark\":\"intelweb\""
+            << ",\"lines\":" << size
+            << ",\"max_data_items\":" << maxDataItems
+            << ",\"ingest_lines_per_sec\":" << perSecond(size, ingestSeconds)
+            << ",\"crawls\":" << options.numCrawls
+            << ",\"crawl_threshold\":" << options.threshold
+            << ",\"crawl_p50_us\":" << percentile(crawlMicroseconds, 50)
+            << ",\"crawl_p90_us\":" << percentile(crawlMicroseconds, 90)
+            << ",\"crawl_p99_us\":" << percentile(crawlMicroseconds, 99)
+            << ",\"crawl_max_us\":" << (crawlMicroseconds.empty() ? 0 : crawlMicroseconds.back())
+            << ",\"bad_entities_found\":" << badEntities
+            << ",\"crawl_frontier_max\":" << counters.crawlFrontierSize.max
+            << ",\"prevalence_checks\":" << counters.prevalenceCheckNanoseconds.count
+            << ",\"prevalence_checks_decided_by_sketch\":" << counters.prevalenceChecksDecidedBySketch
+            << ",\"prevalence_check_mean_ns\":" << counters.prevalenceCheckNanoseconds.mean()
+            << ",\"disk_reads\":" << diskReads
+            << ",\"disk_writes\":" << diskWrites
+            << ",\"file_bytes\":" << bytes
+            << "}" << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        cerr << "usage: " << argv[0] << " [--sizes n,n,...] [--bucket-factors f,f,...] [--crawls n] [--threshold n]"
+             << " [--seed n] [--dir directory] [--out file]" << endl;
+        return 1;
+    }
+
+    ofstream outf;
+    if (!options.outputFile.empty())
+    {
+        outf.open(options.outputFile, ios::app); //append so repeated runs build up a history
+        if (!outf)
+        {
+            cerr << "Cannot open " << options.outputFile << endl;
+            return 1;
+        }
+    }
+    ostream& out = options.outputFile.empty() ? cout : outf;
+
+    for (unsigned int size : options.sizes)
+    {
+        for (double factor : options.bucketFactors)
+        {
+            benchmarkDiskMultiMap(options, size, factor, out);
+            benchmarkIntelWeb(options, size, factor, out);
+        }
+    }
+    return 0;
+}
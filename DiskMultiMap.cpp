@@ -9,7 +9,10 @@
 
 DiskMultiMap::DiskMultiMap()
 {
-    
+    m_currentOperation = Maintenance;
+    m_stats.freeListLength = 0;
+    m_freeListCounted = false;
+    resetStats();
 }
 
 DiskMultiMap::~DiskMultiMap()
@@ -22,6 +25,7 @@ DiskMultiMap::~DiskMultiMap()
 
 bool DiskMultiMap::createNew(const std::string& filename, unsigned int numBuckets)
 {
+    beginOperation(Maintenance);
     if (m_bf.isOpen()) //if the current binary file is open, close it
         m_bf.close();
     if (!m_bf.createNew(filename)) //if unable to create a new file, return false
@@ -29,16 +33,19 @@ bool DiskMultiMap::createNew(const std::string& filename, unsigned int numBucket
     m_numBuckets = numBuckets;
     m_firstUnused = m_numBuckets * m_offsetSize + m_hashTableStart;
     m_freedNodes = -1;
+    writeHeader(); //written straight away so the file can be recognised even if it is never closed
+    STATS_ONLY(m_stats.freeListLength = 0; m_freeListCounted = true;)
     for (int i = m_hashTableStart; i < numBuckets*m_offsetSize+m_hashTableStart; i+= m_offsetSize) //load a offset variable for the number of buckets, representing an "array" of each value in the table
     {
         BinaryFile::Offset temp = -1;
-        m_bf.write(temp, i);
+        diskWrite(temp, i);
     }
     return true; //if able to create new binary file and create "array" of buckets, return true to indicate success
 }
 
 bool DiskMultiMap::openExisting(const std::string& filename)
 {
+    beginOperation(Maintenance);
     if (m_bf.isOpen()) //if there is currently a binary file open, close it
     {
         m_bf.close();
@@ -47,17 +54,22 @@ bool DiskMultiMap::openExisting(const std::string& filename)
     {
         return false;
     }
-    m_bf.read(m_firstUnused, 0);
-    m_bf.read(m_freedNodes, sizeof(BinaryFile::Offset));
-    m_bf.read(m_numBuckets, 2*sizeof(BinaryFile::Offset));
+    unsigned int marker = 0;
+    if (!diskRead(m_firstUnused, 0) || !diskRead(m_freedNodes, sizeof(BinaryFile::Offset))
+        || !diskRead(m_numBuckets, 2*sizeof(BinaryFile::Offset)) || !diskRead(marker, 2*sizeof(BinaryFile::Offset) + sizeof(unsigned int))
+        || marker != m_formatMarker || m_numBuckets == 0) //a file in an older layout would have every bucket read at the wrong offset
+    {
+        m_bf.close();
+        return false;
+    }
+    STATS_ONLY(m_freeListCounted = false;) //the length is not stored in the header, stats() counts it the first time it is asked
     return true;
 }
 
 void DiskMultiMap::close()
 {
-    m_bf.write(m_firstUnused, 0);
-    m_bf.write(m_freedNodes, sizeof(BinaryFile::Offset));
-    m_bf.write(m_numBuckets, 2*sizeof(BinaryFile::Offset));
+    beginOperation(Maintenance);
+    writeHeader();
     if (m_bf.isOpen())
     {
         m_bf.close();
@@ -66,6 +78,7 @@ void DiskMultiMap::close()
 
 bool DiskMultiMap::insert(const std::string& key, const std::string& value, const std::string& context)
 {
+    beginOperation(Insert);
     if (key.size() > 120 || value.size() > 120 || context.size() > 120)
     {
         return false;
@@ -74,44 +87,44 @@ bool DiskMultiMap::insert(const std::string& key, const std::string& value, cons
     hash<string> stringHash; //generate hash value for key string
     int hashValue = stringHash(key)%m_numBuckets;
     BinaryFile::Offset bucket;
-    m_bf.read(bucket, hashValue * m_offsetSize + m_hashTableStart);
+    diskRead(bucket, hashValue * m_offsetSize + m_hashTableStart);
     if (bucket == -1) //case if the bucket is currently empty
     {
         if (m_freedNodes != -1) //if the freed nodes list is not empty
         {
             BinaryFile::Offset freeOffset = generateOpenOffset();
-            m_bf.write(freeOffset,hashValue * m_offsetSize + m_hashTableStart); //set the bucket to one of the freed node
+            diskWrite(freeOffset,hashValue * m_offsetSize + m_hashTableStart); //set the bucket to one of the freed node
             
-            m_bf.write(MultiMapNode(key.c_str(), value.c_str(), context.c_str(), -1), freeOffset); //create the node in that freed space
+            diskWrite(MultiMapNode(key.c_str(), value.c_str(), context.c_str(), -1), freeOffset); //create the node in that freed space
         }
         else //otherwise set the bucket to the next open space on the disk and create a new node at that space
         {
-            m_bf.write(m_firstUnused, hashValue * m_offsetSize + m_hashTableStart); //sets the value in the hash table to the new node
-            m_bf.write(MultiMapNode(key.c_str(), value.c_str(), context.c_str(), -1), m_firstUnused); //writes a new node at the furthest open spot
+            diskWrite(m_firstUnused, hashValue * m_offsetSize + m_hashTableStart); //sets the value in the hash table to the new node
+            diskWrite(MultiMapNode(key.c_str(), value.c_str(), context.c_str(), -1), m_firstUnused); //writes a new node at the furthest open spot
             m_firstUnused += m_nodeSize; //shift the first unused offset by the size of the node
         }
     }
     else //if the bucket is currently being used, access the node is points to and add the node to the end of that
     {
         MultiMapNode temp("","","",0); //temporary node with dummy values used to traverse
-        m_bf.read(temp, bucket); //temp is now set to the first node in the list that the bucket leads to
+        diskRead(temp, bucket); //temp is now set to the first node in the list that the bucket leads to
         BinaryFile::Offset offsetOfTemp = bucket; //stores the offset of temp so it can be changed
         while (temp.next != -1) //while the node continues to point to more nodes
         {
             offsetOfTemp = temp.next;
-            m_bf.read(temp, temp.next); //set temp to the next node in the list
+            diskRead(temp, temp.next); //set temp to the next node in the list
         }
         //temp is now the last node in the list, consider both cases if there are freed nodes or not
         if (m_freedNodes != -1)
         {
             BinaryFile::Offset freeOffset = generateOpenOffset();
-            m_bf.write(MultiMapNode(temp.key, temp.value, temp.context, freeOffset),offsetOfTemp); //update the last node's next offset to be the new node
-            m_bf.write(MultiMapNode(key.c_str(), value.c_str(), context.c_str(), -1), freeOffset); //create the node in that freed space
+            diskWrite(MultiMapNode(temp.key, temp.value, temp.context, freeOffset),offsetOfTemp); //update the last node's next offset to be the new node
+            diskWrite(MultiMapNode(key.c_str(), value.c_str(), context.c_str(), -1), freeOffset); //create the node in that freed space
         }
         else //if there are no free nodes, create the new node by expanding the disk
         {
-            m_bf.write(MultiMapNode(temp.key, temp.value, temp.context, m_firstUnused),offsetOfTemp); //update the last node's next offset to be the new node
-            m_bf.write(MultiMapNode(key.c_str(), value.c_str(), context.c_str(), -1), m_firstUnused); //writes a new node at the furthest open spot
+            diskWrite(MultiMapNode(temp.key, temp.value, temp.context, m_firstUnused),offsetOfTemp); //update the last node's next offset to be the new node
+            diskWrite(MultiMapNode(key.c_str(), value.c_str(), context.c_str(), -1), m_firstUnused); //writes a new node at the furthest open spot
             m_firstUnused += m_nodeSize; //shift the first unused offset by the size of the node
         }
         
@@ -122,33 +135,40 @@ bool DiskMultiMap::insert(const std::string& key, const std::string& value, cons
 
 DiskMultiMap::Iterator DiskMultiMap::search(const std::string& key)
 {
+    beginOperation(Search);
     hash<string> stringHash; //generate hash value for key string and set bucket to the offset that the key string leads to
     int hashValue = stringHash(key)%m_numBuckets;
     BinaryFile::Offset bucket;
-    m_bf.read(bucket, hashValue * m_offsetSize + m_hashTableStart);
+    diskRead(bucket, hashValue * m_offsetSize + m_hashTableStart);
     
     if (bucket == -1) //if the key string leads to an empty bucket, return an invalid iterator
+    {
+        STATS_ONLY(m_stats.searchChainLength.add(0);)
         return Iterator(); //default iterator constructor that start invalid
+    }
     
     queue<MultiMapTuple> queueOfAssociations;
     
     MultiMapNode temp("","","",0); //temporary node with dummy values used to traverse and access values from disk
     
-    m_bf.read(temp, bucket); //temp is set to the node that bucket points to
+    diskRead(temp, bucket); //temp is set to the node that bucket points to
+    STATS_ONLY(unsigned long long chainLength = 1;)
     while (temp.next != -1) //while temp's next offset is not terminating (stops before checking LAST node in list)
     {
+        STATS_ONLY(chainLength++;)
         if (strcmp(temp.key,key.c_str()) == 0) //if the key of this node matches the search key
         {
             MultiMapTuple addToQueue = {temp.key, temp.value, temp.context};
             queueOfAssociations.push(addToQueue);
         }
-        m_bf.read(temp, temp.next); //set temp to the next node
+        diskRead(temp, temp.next); //set temp to the next node
     }
     if (strcmp(temp.key,key.c_str()) == 0) //since the previous node does not check the last node in the list, one last check
     {
         MultiMapTuple addToQueue = {temp.key, temp.value, temp.context};
         queueOfAssociations.push(addToQueue);
     }
+    STATS_ONLY(m_stats.searchChainLength.add(chainLength);)
     
     if (queueOfAssociations.empty()) //if this queue is empty, there were no associations found of the given key, therefore an invalid iterator will be returned
         return Iterator();
@@ -160,17 +180,18 @@ DiskMultiMap::Iterator DiskMultiMap::search(const std::string& key)
 
 int DiskMultiMap::erase(const std::string& key, const std::string& value, const std::string& context)
 {
+    beginOperation(Erase);
     int numRemovals = 0;
     hash<string> stringHash; //generate hash value for key string
     int hashValue = stringHash(key)%m_numBuckets;
     BinaryFile::Offset bucket;
-    m_bf.read(bucket, hashValue*m_offsetSize + m_hashTableStart); //sets bucket variable to the corresponding bucket from the hash value
+    diskRead(bucket, hashValue*m_offsetSize + m_hashTableStart); //sets bucket variable to the corresponding bucket from the hash value
     
     if (bucket == -1) //if the key string does not map to and value, return numRemovals(which is 0) since there is nothing to remove
         return numRemovals;
     
     MultiMapNode temp("","","",0); //temporary node with dummy values to be replaced
-    m_bf.read(temp, bucket); //set temp to the node that bucket points to
+    diskRead(temp, bucket); //set temp to the node that bucket points to
     
     BinaryFile::Offset currentNode = bucket;
     //the following loop covers the case of the first node the hash table points to being removed, since the offset value of the hashtable will need to be changed
@@ -178,33 +199,33 @@ int DiskMultiMap::erase(const std::string& key, const std::string& value, const
     while (strcmp(temp.key, key.c_str()) == 0 && strcmp(temp.value, value.c_str()) == 0 && strcmp(temp.context, context.c_str()) == 0) //while the temp node matches the parameter values
     {
         addToUnusedNodes(currentNode); //add the current node to the unused nodes
-        m_bf.write(temp.next, hashValue*m_offsetSize + m_hashTableStart); // set the bucket in the hash table to point to the next node since the previous one was removed
+        diskWrite(temp.next, hashValue*m_offsetSize + m_hashTableStart); // set the bucket in the hash table to point to the next node since the previous one was removed
         numRemovals++;  //increment the number of removed associations
         if (temp.next == -1) //if there is no next node, return the number of removals
             return numRemovals;
         currentNode = temp.next;
-        m_bf.read(temp, temp.next); //set temp to the next node
+        diskRead(temp, temp.next); //set temp to the next node
     }
     
     //the next loop no longer needs to make changes to the hash table but only the adjacent node
     
     MultiMapNode nextNode("","","",0); //temp node representing the next node with dummy values
-    m_bf.read(nextNode, temp.next);
+    diskRead(nextNode, temp.next);
     while (temp.next != -1) //while the next node exists
     {
-        m_bf.read(nextNode, temp.next);
+        diskRead(nextNode, temp.next);
         if (strcmp(nextNode.key, key.c_str()) == 0 && strcmp(nextNode.value, value.c_str()) == 0 && strcmp(nextNode.context, context.c_str()) == 0) //if the next node values match the parameter
         {
             addToUnusedNodes(temp.next); //add the removed node to the unused nodes
-            m_bf.write(MultiMapNode(temp.key, temp.value, temp.context, nextNode.next),currentNode); //set the current node to point to the next node's next
+            diskWrite(MultiMapNode(temp.key, temp.value, temp.context, nextNode.next),currentNode); //set the current node to point to the next node's next
             numRemovals++; //increment the number of removed associations
             currentNode = temp.next; //set sthe current node to the next node
-            m_bf.read(temp, temp.next); //set temp to the next node
+            diskRead(temp, temp.next); //set temp to the next node
         }
         else
         {
             currentNode = temp.next;
-            m_bf.read(temp,temp.next);
+            diskRead(temp,temp.next);
         }
         
     } //this loop concludes when temp reaches the last node (which has already been checked since the NEXT node is what is checked)
@@ -213,31 +234,116 @@ int DiskMultiMap::erase(const std::string& key, const std::string& value, const
     
     
 }
+unsigned int DiskMultiMap::countUpTo(const std::string& key, unsigned int limit)
+{
+    beginOperation(Search);
+    if (limit == 0)
+        return 0;
+    hash<string> stringHash; //generate hash value for key string
+    int hashValue = stringHash(key)%m_numBuckets;
+    BinaryFile::Offset node;
+    if (!diskRead(node, hashValue * m_offsetSize + m_hashTableStart))
+        return 0;
+    
+    //unlike search, nothing is copied out of the nodes, each key is compared where it was read
+    unsigned int numMatches = 0;
+    MultiMapNode temp("","","",0);
+    while (node != -1 && diskRead(temp, node)) //stop at the end of the chain, or at a failed read rather than loop on a stale next offset
+    {
+        if (strcmp(temp.key, key.c_str()) == 0 && ++numMatches >= limit)
+            break;
+        node = temp.next;
+    }
+    return numMatches;
+}
+
 //private DiskMultiMap helper functions
 
+void DiskMultiMap::writeHeader()
+{
+    unsigned int marker = m_formatMarker;
+    diskWrite(m_firstUnused, 0);
+    diskWrite(m_freedNodes, sizeof(BinaryFile::Offset));
+    diskWrite(m_numBuckets, 2*sizeof(BinaryFile::Offset));
+    diskWrite(marker, 2*sizeof(BinaryFile::Offset) + sizeof(unsigned int));
+}
+
 BinaryFile::Offset DiskMultiMap::generateOpenOffset()
 {
     if (m_freedNodes == -1) //if the list is empty, return -1
         return -1;
     MultiMapNode temp("","","",0); //dummy values to be replaced
-    m_bf.read(temp, m_freedNodes);
+    diskRead(temp, m_freedNodes);
     BinaryFile::Offset freeOffset = m_freedNodes;
     m_freedNodes = temp.next; //sets the m_unusedNode to the next in the list
+    STATS_ONLY(if (m_freeListCounted) m_stats.freeListLength--;)
     return freeOffset;
 }
 
 void DiskMultiMap::addToUnusedNodes(BinaryFile::Offset offset)
 {
+    STATS_ONLY(if (m_freeListCounted) m_stats.freeListLength++;)
     if (m_freedNodes == -1) //case for if the list is initally empty
     {
         m_freedNodes = offset;
-        m_bf.write(MultiMapNode("","","", -1),offset); //generates a node with dummy values and a terminating next offset
+        diskWrite(MultiMapNode("","","", -1),offset); //generates a node with dummy values and a terminating next offset
         return;
     }
-    m_bf.write(MultiMapNode("","","", m_freedNodes), offset); //creates a node with dummy value, offset is the old head pointer set at the offset parameter
+    diskWrite(MultiMapNode("","","", m_freedNodes), offset); //creates a node with dummy value, offset is the old head pointer set at the offset parameter
     m_freedNodes = offset; //sets the new head as the offset
 }
 
+DiskMultiMap::Stats DiskMultiMap::stats(bool scanFile, bool countFreeList)
+{
+    (void)scanFile; //unused when stats are compiled out
+    (void)countFreeList;
+    STATS_ONLY(
+    //reads here go straight to m_bf so they do not show up in the operation counters
+    if (countFreeList && !m_freeListCounted && m_bf.isOpen()) //walks every freed node once after openExisting, later changes are counted as they happen
+    {
+        MultiMapNode temp("","","",0);
+        m_stats.freeListLength = 0;
+        for (BinaryFile::Offset freed = m_freedNodes; freed != -1 && m_bf.read(temp, freed); freed = temp.next) //stop at a failed read rather than loop on a stale next offset
+            m_stats.freeListLength++;
+        m_freeListCounted = true;
+    }
+    )
+    Stats current = m_stats;
+    current.freeListLengthKnown = m_freeListCounted;
+    current.fileBytes = m_bf.isOpen() ? m_firstUnused : 0;
+    STATS_ONLY(
+    if (scanFile && m_bf.isOpen()) //scanning every bucket is far more expensive than the counters
+    {
+        MultiMapNode temp("","","",0);
+        for (unsigned int i = 0; i < m_numBuckets; i++)
+        {
+            BinaryFile::Offset node;
+            if (!m_bf.read(node, i * m_offsetSize + m_hashTableStart))
+                break;
+            unsigned long long nodesInBucket = 0;
+            for (; node != -1 && m_bf.read(temp, node); node = temp.next)
+                nodesInBucket++;
+            current.bucketOccupancy.add(nodesInBucket);
+        }
+    }
+    )
+    return current;
+}
+
+void DiskMultiMap::resetStats()
+{
+    for (int i = 0; i < NumOperations; i++)
+    {
+        m_stats.operations[i].calls = 0;
+        m_stats.operations[i].diskReads = 0;
+        m_stats.operations[i].diskWrites = 0;
+    }
+    m_stats.searchChainLength.reset();
+    m_stats.bucketOccupancy.reset();
+    //the free list length describes the file rather than past operations, so it is kept
+    m_stats.fileBytes = 0;
+}
+
 //Iterator class implementation
 
 DiskMultiMap::Iterator::Iterator()
@@ -4,6 +4,7 @@
 #include <string>
 #include "MultiMapTuple.h"
 #include "BinaryFile.h"
+#include "Stats.h"
 #include <queue>
 
 class DiskMultiMap
@@ -35,6 +36,28 @@ public:
     bool insert(const std::string& key, const std::string& value, const std::string& context);
     Iterator search(const std::string& key);
     int erase(const std::string& key, const std::string& value, const std::string& context);
+    unsigned int countUpTo(const std::string& key, unsigned int limit); //number of associations with this key, but stops walking the chain once limit is reached
+    
+    enum Operation { Insert, Search, Erase, Maintenance, NumOperations }; //Maintenance covers createNew, openExisting and close
+    struct OperationStats
+    {
+        unsigned long long calls;
+        unsigned long long diskReads;
+        unsigned long long diskWrites;
+    };
+    struct Stats
+    {
+        OperationStats operations[NumOperations]; //indexed by Operation
+        Histogram searchChainLength; //nodes read from disk per search
+        Histogram bucketOccupancy; //nodes per bucket, only filled in when stats() is asked to scan the file
+        unsigned long long freeListLength; //freed nodes waiting to be reused, counted on the first stats() call after openExisting that allows it
+        bool freeListLengthKnown; //false if the free list has not been counted yet, freeListLength is then meaningless
+        unsigned long long fileBytes; //size of the file once the header is written
+    };
+    //scanning walks every bucket, so it is far more expensive than the counters. Counting the free list walks every freed node,
+    //but only once after openExisting; pass false to leave it uncounted when the caller must not stall
+    Stats stats(bool scanFile = false, bool countFreeList = true);
+    void resetStats();
     
 private:
     BinaryFile m_bf;
@@ -56,11 +79,33 @@ private:
     const unsigned int m_nodeSize = sizeof(MultiMapNode); //368
     BinaryFile::Offset m_firstUnused; //first offset that is completely unused
     BinaryFile::Offset m_freedNodes; //list of nodes that have previously been freed and should be reused
-    const unsigned int m_hashTableStart = 12; //change to constant?
+    static const unsigned int m_formatMarker = 0x324d4d44; //"DMM2", files without it predate the current header layout and are rejected
+    const unsigned int m_hashTableStart = 2*sizeof(BinaryFile::Offset) + 2*sizeof(unsigned int); //the table starts right after the header (first unused offset, freed node list, number of buckets, format marker)
+    Stats m_stats;
+    Operation m_currentOperation; //the operation that disk reads and writes are currently charged to
+    bool m_freeListCounted; //false until m_stats.freeListLength matches the free list on disk
     
     //helper functions
     void addToUnusedNodes(BinaryFile::Offset offset);
     BinaryFile::Offset generateOpenOffset();
+    void writeHeader();
+    void beginOperation(Operation operation)
+    {
+        (void)operation; //unused when stats are compiled out
+        STATS_ONLY(m_currentOperation = operation; m_stats.operations[operation].calls++;)
+    }
+    template <typename T>
+    bool diskRead(T& x, BinaryFile::Offset fromOffset) //every read of the file goes through here so it can be counted
+    {
+        STATS_ONLY(m_stats.operations[m_currentOperation].diskReads++;)
+        return m_bf.read(x, fromOffset);
+    }
+    template <typename T>
+    bool diskWrite(const T& x, BinaryFile::Offset toOffset) //every write to the file goes through here so it can be counted
+    {
+        STATS_ONLY(m_stats.operations[m_currentOperation].diskWrites++;)
+        return m_bf.write(x, toOffset);
+    }
     
 };
 
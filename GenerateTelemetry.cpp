@@ -0,0 +1,30 @@
+//Writes a synthetic telemetry file that IntelWeb::ingest can read.
+//
+//  make generate_telemetry
+//  ./generate_telemetry telemetry.txt 100000 [seed]
+//
+//The number of machines, files and domains scales with the number of lines, so larger files keep the same shape.
+
+#include "TelemetryGenerator.h"
+#include <iostream>
+#include <cstdlib>
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "usage: " << argv[0] << " <output file> <number of lines> [seed]" << endl;
+        return 1;
+    }
+    unsigned int numLines = static_cast<unsigned int>(strtoul(argv[2], nullptr, 10));
+    unsigned int seed = argc > 3 ? static_cast<unsigned int>(strtoul(argv[3], nullptr, 10)) : 1;
+
+    TelemetryGenerator generator(numLines/50 + 1, numLines/4 + 1, numLines/10 + 1, seed);
+    if (!generator.generate(argv[1], numLines))
+    {
+        cerr << "Cannot write " << argv[1] << endl;
+        return 1;
+    }
+    return 0;
+}
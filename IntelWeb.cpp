@@ -5,11 +5,18 @@
 #include <unordered_map>
 #include <set>
 #include <queue>
+#include <functional>
 using namespace std;
 
+typedef chrono::steady_clock Clock;
+
 IntelWeb::IntelWeb()
 {
-    
+    m_sketchWidth = 0;
+    m_sketchValid = false;
+    m_statsDumpStream = nullptr;
+    m_statsDumpSeconds = 0;
+    resetStats();
 }
 
 IntelWeb::~IntelWeb()
@@ -29,6 +36,17 @@ bool IntelWeb::createNew(const std::string& filePrefix, unsigned int maxDataItem
         m_sourceToDestination.close();
         return false;
     }
+    if (!m_sketchFile.createNew(filePrefix+".prevalenceSketch"))
+    {
+        m_sourceToDestination.close();
+        m_destinationToSource.close();
+        return false;
+    }
+    
+    //the sketch gets as many counters per row as the multimaps have buckets, all starting at zero
+    m_sketchWidth = maxDataItems*2 > 0 ? maxDataItems*2 : 1;
+    m_sketch.assign(static_cast<size_t>(m_sketchDepth)*m_sketchWidth, 0);
+    m_sketchValid = true;
     
     return true;
     
@@ -45,6 +63,35 @@ bool IntelWeb::openExisting(const std::string& filePrefix)
         m_sourceToDestination.close();
         return false;
     }
+    
+    //a missing or malformed sketch is not an error, prevalence checks just fall back to counting on disk
+    m_sketchValid = false;
+    m_sketch.clear();
+    if (!m_sketchFile.openExisting(filePrefix+".prevalenceSketch"))
+        return true;
+    unsigned int depth = 0, version = 0;
+    if (!m_sketchFile.read(m_sketchWidth, 0) || !m_sketchFile.read(depth, sizeof(unsigned int)) || !m_sketchFile.read(version, 2*sizeof(unsigned int))
+        || depth != m_sketchDepth || version != m_sketchVersion || m_sketchWidth == 0)
+    {
+        m_sketchFile.close();
+        return true;
+    }
+    //the header must describe exactly the counters the file holds, otherwise a corrupt width could overflow the size or ask for a huge allocation
+    size_t numCounters = static_cast<size_t>(m_sketchDepth) * m_sketchWidth;
+    if (numCounters / m_sketchDepth != m_sketchWidth || numCounters > (static_cast<size_t>(-1) - m_sketchStart) / sizeof(unsigned int)
+        || static_cast<size_t>(m_sketchFile.fileLength()) != m_sketchStart + numCounters*sizeof(unsigned int))
+    {
+        m_sketchFile.close();
+        return true;
+    }
+    m_sketch.resize(numCounters);
+    if (m_sketch.empty() || !m_sketchFile.read(reinterpret_cast<char*>(&m_sketch[0]), m_sketch.size()*sizeof(unsigned int), m_sketchStart)) //load every counter with a single read
+    {
+        m_sketch.clear();
+        m_sketchFile.close();
+        return true;
+    }
+    m_sketchValid = true;
     return true;
 }
 
@@ -52,6 +99,20 @@ void IntelWeb::close()
 {
     m_sourceToDestination.close();
     m_destinationToSource.close();
+    if (m_sketchFile.isOpen()) //write the sketch back out so it survives until the next openExisting
+    {
+        if (m_sketchValid)
+        {
+            unsigned int depth = m_sketchDepth, version = m_sketchVersion;
+            m_sketchFile.write(m_sketchWidth, 0);
+            m_sketchFile.write(depth, sizeof(unsigned int));
+            m_sketchFile.write(version, 2*sizeof(unsigned int));
+            m_sketchFile.write(reinterpret_cast<const char*>(&m_sketch[0]), m_sketch.size()*sizeof(unsigned int), m_sketchStart);
+        }
+        m_sketchFile.close();
+    }
+    m_sketchValid = false;
+    m_sketch.clear();
 }
 
 bool IntelWeb::ingest(const std::string& telemetryFile)
@@ -64,16 +125,29 @@ bool IntelWeb::ingest(const std::string& telemetryFile)
         return false;
     }
     
+    STATS_ONLY(Clock::time_point checkpoint = Clock::now(); unsigned long long linesSinceCheckpoint = 0;)
     string line;
     while (getline(inf, line))
     {
+        STATS_ONLY(
+        if (++linesSinceCheckpoint == 1024) //only look at the clock every so often to keep the per-line cost down
+        {
+            Clock::time_point now = Clock::now();
+            m_stats.ingestSeconds += chrono::duration<double>(now - checkpoint).count();
+            checkpoint = now;
+            linesSinceCheckpoint = 0;
+            dumpStatsIfDue();
+        }
+        )
         istringstream iss(line);
         string key, value, context;
         if (! (iss >> context >> key >> value))
         {
+            STATS_ONLY(m_stats.malformedLines++;)
             cout << "Badly formatted line: " << line << endl;
             continue;
         }
+        STATS_ONLY(m_stats.linesIngested++;)
         
         /*char dummy;
         if (iss >> dummy) // succeeds if there a non-whitespace char
@@ -81,13 +155,15 @@ bool IntelWeb::ingest(const std::string& telemetryFile)
         
         //Each pair of interations is stored into the DiskMultiMaps in both orders
         
-        m_sourceToDestination.insert(key, value, context);
-        m_destinationToSource.insert(value, key, context);
+        if (m_sourceToDestination.insert(key, value, context) && m_destinationToSource.insert(value, key, context))
+        {
+            //the key now appears once more in the source map and the value once more in the destination map
+            addToSketch(key, 1);
+            addToSketch(value, 1);
+        }
         
     }
-    
-    
-    
+    STATS_ONLY(m_stats.ingestSeconds += chrono::duration<double>(Clock::now() - checkpoint).count();)
     
     return true;
     
@@ -99,6 +175,7 @@ unsigned int IntelWeb::crawl(const std::vector<std::string>& indicators, unsigne
     set<InteractionTuple> interactionsSet; //set representing all the associations;
     queue<std::string> maliciousAssociationsQueue; //a queue used simulate a breadth first search through associations
     set<std::string> knownGoodEntites; //set of entites that are known to be above the threshold
+    STATS_ONLY(unsigned long long largestFrontier = indicators.size(), entitiesVisited = 0;)
     
     //start by enqueuing each of the indicator entities from the vector into the queue
     for (const std::string s: indicators)
@@ -111,6 +188,7 @@ unsigned int IntelWeb::crawl(const std::vector<std::string>& indicators, unsigne
         bool foundOneAssociation = false; //bool represeting if there were any associations found with this entity only relevant for the initial indicators list
         std::string maliciousEntity = maliciousAssociationsQueue.front(); //set temporary variable to front of queue
         maliciousAssociationsQueue.pop(); //pop value off queue
+        STATS_ONLY(entitiesVisited++;)
         
         if (knownGoodEntites.count(maliciousEntity) == 1) //if the entity is present in the set of knownGoodEntities
         {
@@ -157,7 +235,17 @@ unsigned int IntelWeb::crawl(const std::vector<std::string>& indicators, unsigne
         if (foundOneAssociation) //this is only relevant for the initial list of indicators, since if there are no associations with them, they are not added to the list of bad entities found
             badEntitiesSet.insert(maliciousEntity);
         
+        STATS_ONLY(
+        if (maliciousAssociationsQueue.size() > largestFrontier)
+            largestFrontier = maliciousAssociationsQueue.size();
+        )
     }
+    STATS_ONLY(
+    m_stats.crawls++;
+    m_stats.crawlFrontierSize.add(largestFrontier);
+    m_stats.crawlEntitiesVisited.add(entitiesVisited);
+    dumpStatsIfDue();
+    )
     //when the loop ends all bad entities should be in badEntitiesSet and all interations involving them should be in interactionsSet
     
     badEntitiesFound.clear(); //any extraneous pre-existing values in the vector are cleared
@@ -191,8 +279,8 @@ bool IntelWeb::purge(const std::string& entity)
     {
         atLeastOneRemoved = true;
         MultiMapTuple tempMMT = *sources;
-        m_sourceToDestination.erase(tempMMT.key, tempMMT.value, tempMMT.context); //erase from the current multi map
-        m_destinationToSource.erase(tempMMT.value, tempMMT.key, tempMMT.context); //erase from the opposite multimap by flipping order of key and value
+        addToSketch(tempMMT.key, -m_sourceToDestination.erase(tempMMT.key, tempMMT.value, tempMMT.context)); //erase from the current multi map
+        addToSketch(tempMMT.value, -m_destinationToSource.erase(tempMMT.value, tempMMT.key, tempMMT.context)); //erase from the opposite multimap by flipping order of key and value
         ++sources;
     }
     
@@ -201,8 +289,8 @@ bool IntelWeb::purge(const std::string& entity)
     {
         atLeastOneRemoved = true;
         MultiMapTuple tempMMT = *destinations;
-        m_destinationToSource.erase(tempMMT.key, tempMMT.value, tempMMT.context);
-        m_sourceToDestination.erase(tempMMT.value, tempMMT.key, tempMMT.context); //erase from opposite multimap by flipping order of key and value
+        addToSketch(tempMMT.key, -m_destinationToSource.erase(tempMMT.key, tempMMT.value, tempMMT.context));
+        addToSketch(tempMMT.value, -m_sourceToDestination.erase(tempMMT.value, tempMMT.key, tempMMT.context)); //erase from opposite multimap by flipping order of key and value
         ++destinations;
     }
     
@@ -210,6 +298,80 @@ bool IntelWeb::purge(const std::string& entity)
     
 }
 
+IntelWeb::Stats IntelWeb::stats(bool scanFiles, bool countFreeLists)
+{
+    Stats current = m_stats;
+    current.sourceToDestination = m_sourceToDestination.stats(scanFiles, countFreeLists);
+    current.destinationToSource = m_destinationToSource.stats(scanFiles, countFreeLists);
+    return current;
+}
+
+void IntelWeb::resetStats()
+{
+    m_sourceToDestination.resetStats();
+    m_destinationToSource.resetStats();
+    m_stats.linesIngested = 0;
+    m_stats.malformedLines = 0;
+    m_stats.ingestSeconds = 0;
+    m_stats.crawls = 0;
+    m_stats.crawlFrontierSize.reset();
+    m_stats.crawlEntitiesVisited.reset();
+    m_stats.prevalenceCheckNanoseconds.reset();
+    m_stats.prevalenceChecksDecidedBySketch = 0;
+}
+
+namespace
+{
+    void writeDiskMultiMapStats(std::ostream& out, const DiskMultiMap::Stats& mapStats)
+    {
+        const char* names[DiskMultiMap::NumOperations] = {"insert", "search", "erase", "maintenance"};
+        out << "{";
+        for (int i = 0; i < DiskMultiMap::NumOperations; i++)
+        {
+            const DiskMultiMap::OperationStats& op = mapStats.operations[i];
+            out << "\"" << names[i] << "\":{\"calls\":" << op.calls << ",\"disk_reads\":" << op.diskReads << ",\"disk_writes\":" << op.diskWrites << "},";
+        }
+        out << "\"search_chain_length\":";
+        mapStats.searchChainLength.writeJson(out);
+        out << ",\"bucket_occupancy\":";
+        mapStats.bucketOccupancy.writeJson(out);
+        out << ",\"free_list_length\":";
+        if (mapStats.freeListLengthKnown)
+            out << mapStats.freeListLength;
+        else
+            out << "null"; //not counted yet, see DiskMultiMap::stats
+        out << ",\"file_bytes\":" << mapStats.fileBytes << "}";
+    }
+}
+
+void IntelWeb::writeStats(std::ostream& out, bool scanFiles, bool countFreeLists)
+{
+    Stats current = stats(scanFiles, countFreeLists);
+    out << "{\"source_to_destination\":";
+    writeDiskMultiMapStats(out, current.sourceToDestination);
+    out << ",\"destination_to_source\":";
+    writeDiskMultiMapStats(out, current.destinationToSource);
+    out << ",\"lines_ingested\":" << current.linesIngested
+        << ",\"malformed_lines\":" << current.malformedLines
+        << ",\"ingest_seconds\":" << current.ingestSeconds
+        << ",\"ingest_lines_per_sec\":" << current.ingestLinesPerSecond()
+        << ",\"crawls\":" << current.crawls
+        << ",\"crawl_frontier_size\":";
+    current.crawlFrontierSize.writeJson(out);
+    out << ",\"crawl_entities_visited\":";
+    current.crawlEntitiesVisited.writeJson(out);
+    out << ",\"prevalence_check_ns\":";
+    current.prevalenceCheckNanoseconds.writeJson(out);
+    out << ",\"prevalence_checks_decided_by_sketch\":" << current.prevalenceChecksDecidedBySketch << "}" << endl;
+}
+
+void IntelWeb::dumpStatsEvery(std::ostream* out, unsigned int seconds)
+{
+    m_statsDumpStream = out;
+    m_statsDumpSeconds = seconds;
+    m_lastStatsDump = Clock::now();
+}
+
 /*
 int main()
 {
@@ -251,19 +413,79 @@ int main()
 
 bool IntelWeb::isPrevalent(string entity, unsigned int threshold)
 {
-    unsigned int numOccurances = 0;
-    DiskMultiMap::Iterator sources = m_sourceToDestination.search(entity);
-    DiskMultiMap::Iterator destinations = m_destinationToSource.search(entity);
-    while (sources.isValid())
+    STATS_ONLY(Clock::time_point start = Clock::now();)
+    bool prevalent;
+    //the sketch never underestimates, so an estimate below the threshold means the entity is definitely not prevalent
+    if (m_sketchValid && sketchEstimate(entity) < threshold)
     {
-        numOccurances++;
-        ++sources;
+        prevalent = false;
+        STATS_ONLY(m_stats.prevalenceChecksDecidedBySketch++;)
     }
-    while (destinations.isValid())
+    else //otherwise the estimate may be inflated by collisions, so confirm with an exact count
     {
-        numOccurances++;
-        ++destinations;
+        prevalent = countOccurances(entity, threshold) >= threshold;
     }
-    return numOccurances >= threshold;
+    STATS_ONLY(m_stats.prevalenceCheckNanoseconds.add(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());)
+    return prevalent;
 }
 
+unsigned int IntelWeb::countOccurances(const std::string& entity, unsigned int stopAt)
+{
+    //both walks stop as soon as stopAt occurances have been seen, so prevalent entities with long chains stay cheap
+    unsigned int numOccurances = m_sourceToDestination.countUpTo(entity, stopAt);
+    if (numOccurances >= stopAt) //no need to look at the second map if the count is already high enough
+        return numOccurances;
+    return numOccurances + m_destinationToSource.countUpTo(entity, stopAt - numOccurances);
+}
+
+void IntelWeb::addToSketch(const std::string& entity, int delta)
+{
+    if (!m_sketchValid || delta == 0)
+        return;
+    hash<string> stringHash;
+    size_t hashValue = stringHash(entity);
+    for (unsigned int row = 0; row < m_sketchDepth; row++)
+    {
+        unsigned int& counter = m_sketch[sketchIndex(row, hashValue)];
+        if (delta < 0 && counter < static_cast<unsigned int>(-delta)) //should never happen since only removed associations are subtracted, but avoid wrapping around
+            counter = 0;
+        else
+            counter += delta;
+    }
+}
+
+unsigned int IntelWeb::sketchEstimate(const std::string& entity) const
+{
+    hash<string> stringHash;
+    size_t hashValue = stringHash(entity);
+    unsigned int estimate = m_sketch[sketchIndex(0, hashValue)];
+    for (unsigned int row = 1; row < m_sketchDepth; row++) //the smallest counter is the one with the fewest collisions
+    {
+        unsigned int counter = m_sketch[sketchIndex(row, hashValue)];
+        if (counter < estimate)
+            estimate = counter;
+    }
+    return estimate;
+}
+
+void IntelWeb::dumpStatsIfDue()
+{
+    if (m_statsDumpStream == nullptr)
+        return;
+    Clock::time_point now = Clock::now();
+    if (now - m_lastStatsDump < chrono::seconds(m_statsDumpSeconds))
+        return;
+    m_lastStatsDump = now;
+    writeStats(*m_statsDumpStream, false, false); //no bucket scan or free list walk, a periodic dump should not stall the operation that triggered it
+}
+
+size_t IntelWeb::sketchIndex(unsigned int row, size_t hashValue) const
+{
+    //each row gets its own column by mixing the string hash with the row number (the splitmix64 finalizer),
+    //so columns in different rows are independent whatever the width and however many bits size_t has
+    unsigned long long mixed = static_cast<unsigned long long>(hashValue) + (row + 1) * 0x9e3779b97f4a7c15ULL;
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    mixed ^= mixed >> 31;
+    return static_cast<size_t>(row)*m_sketchWidth + static_cast<size_t>(mixed % m_sketchWidth);
+}
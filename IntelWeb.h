@@ -3,8 +3,11 @@
 
 #include "InteractionTuple.h"
 #include "DiskMultiMap.h"
+#include "Stats.h"
 #include <string>
 #include <vector>
+#include <ostream>
+#include <chrono>
 
 class IntelWeb
 {
@@ -22,10 +25,51 @@ public:
                        );
     bool purge(const std::string& entity);
     
+    struct Stats
+    {
+        DiskMultiMap::Stats sourceToDestination, destinationToSource;
+        unsigned long long linesIngested; //well formed lines stored by ingest
+        unsigned long long malformedLines;
+        double ingestSeconds; //time spent inside ingest
+        double ingestLinesPerSecond() const
+        {
+            return ingestSeconds > 0 ? (linesIngested + malformedLines) / ingestSeconds : 0;
+        }
+        unsigned long long crawls;
+        Histogram crawlFrontierSize; //largest number of entities waiting to be visited at once, per crawl
+        Histogram crawlEntitiesVisited; //entities taken off the queue, per crawl
+        Histogram prevalenceCheckNanoseconds;
+        unsigned long long prevalenceChecksDecidedBySketch; //checks answered without reading the disk
+    };
+    Stats stats(bool scanFiles = false, bool countFreeLists = true); //scanFiles fills in the bucket occupancy of both maps, which reads every bucket
+    void resetStats();
+    void writeStats(std::ostream& out, bool scanFiles = false, bool countFreeLists = true); //one JSON object per call, on a single line
+    void dumpStatsEvery(std::ostream* out, unsigned int seconds); //writes stats during ingest and after crawls at most this often, nullptr turns it off
+    
 private:
     DiskMultiMap m_sourceToDestination, m_destinationToSource;
-    //helper function
+    
+    //count-min sketch of how many times each entity appears in either map, kept in memory and persisted on close
+    BinaryFile m_sketchFile;
+    std::vector<unsigned int> m_sketch; //m_sketchDepth rows of m_sketchWidth counters each, stored row after row
+    unsigned int m_sketchWidth;
+    bool m_sketchValid; //false if no sketch could be loaded, in which case every prevalence check is exact
+    static const unsigned int m_sketchDepth = 4;
+    static const unsigned int m_sketchVersion = 2; //bumped whenever the counter layout changes, older files would give underestimates
+    const unsigned int m_sketchStart = 12; //the width, depth and version are stored at the start of the file, followed by the counters
+    
+    //helper functions
     bool isPrevalent(std::string, unsigned int threshold);
+    unsigned int countOccurances(const std::string& entity, unsigned int stopAt);
+    void addToSketch(const std::string& entity, int delta);
+    unsigned int sketchEstimate(const std::string& entity) const;
+    size_t sketchIndex(unsigned int row, size_t hashValue) const;
+    
+    Stats m_stats;
+    std::ostream* m_statsDumpStream;
+    unsigned int m_statsDumpSeconds;
+    std::chrono::steady_clock::time_point m_lastStatsDump;
+    void dumpStatsIfDue();
     
     // Your private member declarations will go here
 };
@@ -0,0 +1,178 @@
+//Checks that the prevalence sketch never changes what crawl finds: the sketch may only skip disk reads for entities
+//that are certainly not prevalent, and a missing, truncated or corrupt sketch file must fall back to exact counts.
+//
+//  make check SKELETON_DIR=/path/to/skeleton
+//  ./sketch_check [directory for scratch files]
+//
+//Exits with a non-zero status and prints what differed if any check fails.
+
+#include "IntelWeb.h"
+#include "TelemetryGenerator.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+using namespace std;
+
+namespace
+{
+    struct CrawlResult
+    {
+        vector<string> badEntities;
+        vector<InteractionTuple> interactions;
+    };
+
+    const unsigned int thresholds[] = {2, 5, 10, 50};
+    int failures = 0;
+
+    void check(bool condition, const string& what)
+    {
+        if (!condition)
+        {
+            cout << "FAIL: " << what << endl;
+            failures++;
+        }
+    }
+
+    bool sameInteractions(const vector<InteractionTuple>& a, const vector<InteractionTuple>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i] < b[i] || b[i] < a[i])
+                return false;
+        }
+        return true;
+    }
+
+    //crawls from every indicator at every threshold, in a fixed order so two runs can be compared entry by entry
+    vector<CrawlResult> crawlAll(const string& prefix, const vector<string>& indicators, unsigned long long& decidedBySketch)
+    {
+        vector<CrawlResult> results;
+        IntelWeb web;
+        if (!web.openExisting(prefix))
+        {
+            check(false, "openExisting " + prefix);
+            return results;
+        }
+        for (unsigned int threshold : thresholds)
+        {
+            for (const string& indicator : indicators)
+            {
+                CrawlResult result;
+                web.crawl(vector<string>(1, indicator), threshold, result.badEntities, result.interactions);
+                results.push_back(result);
+            }
+        }
+        decidedBySketch = web.stats().prevalenceChecksDecidedBySketch;
+        web.close();
+        return results;
+    }
+
+    void compare(const vector<CrawlResult>& expected, const vector<CrawlResult>& actual, const string& variant)
+    {
+        check(expected.size() == actual.size(), variant + ": number of crawls");
+        for (size_t i = 0; i < expected.size() && i < actual.size(); i++)
+        {
+            check(expected[i].badEntities == actual[i].badEntities, variant + ": bad entities of crawl " + to_string(i));
+            check(sameInteractions(expected[i].interactions, actual[i].interactions), variant + ": interactions of crawl " + to_string(i));
+        }
+    }
+
+    bool copyFile(const string& from, const string& to, long bytesToKeep) //a negative bytesToKeep copies the whole file
+    {
+        ifstream inf(from, ios::binary);
+        ofstream outf(to, ios::binary | ios::trunc);
+        if (!inf || !outf)
+            return false;
+        char c;
+        for (long i = 0; (bytesToKeep < 0 || i < bytesToKeep) && inf.get(c); i++)
+            outf.put(c);
+        return static_cast<bool>(outf);
+    }
+
+    void overwriteWord(const string& filename, long offset, unsigned int word)
+    {
+        fstream f(filename, ios::in | ios::out | ios::binary);
+        f.seekp(offset);
+        f.write(reinterpret_cast<const char*>(&word), sizeof(word));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    string directory = argc > 1 ? argv[1] : ".";
+    string telemetryFile = directory + "/sketch_check.telemetry.txt";
+    string prefix = directory + "/sketch_check";
+    string sketchFile = prefix + ".prevalenceSketch";
+    string savedSketch = sketchFile + ".saved";
+
+    TelemetryGenerator generator(60, 750, 300, 7);
+    if (!generator.generate(telemetryFile, 3000))
+    {
+        cout << "FAIL: cannot write " << telemetryFile << endl;
+        return 1;
+    }
+    vector<string> indicators;
+    for (int i = 0; i < 25; i++)
+        indicators.push_back(generator.randomFile());
+
+    {
+        //small maxDataItems so the sketch has plenty of collisions to overestimate with
+        IntelWeb web;
+        check(web.createNew(prefix, 100), "createNew");
+        check(web.ingest(telemetryFile), "ingest");
+        //purging both a prevalent and some rare entities exercises the subtractions from the sketch
+        web.purge(generator.domainName(0));
+        for (int i = 0; i < 5; i++)
+            web.purge(indicators[i]);
+        web.close();
+    }
+
+    unsigned long long decided = 0;
+    vector<CrawlResult> withSketch = crawlAll(prefix, indicators, decided);
+#ifndef CYBERSPIDER_NO_STATS
+    check(decided > 0, "the sketch decided no prevalence checks at all");
+#endif
+    copyFile(sketchFile, savedSketch, -1);
+
+    remove(sketchFile.c_str());
+    vector<CrawlResult> exact = crawlAll(prefix, indicators, decided);
+    check(decided == 0, "without a sketch file every check should be exact");
+    compare(exact, withSketch, "with sketch");
+
+    long sketchBytes = 0;
+    {
+        ifstream inf(savedSketch, ios::binary | ios::ate);
+        sketchBytes = static_cast<long>(inf.tellg());
+    }
+    struct Corruption { string name; long keepBytes; long offset; unsigned int word; };
+    const Corruption corruptions[] = {
+        {"truncated sketch", sketchBytes / 2, -1, 0},
+        {"header only", 12, -1, 0},
+        {"huge width", -1, 0, 0x40000000},
+        {"wrong depth", -1, 4, 3},
+        {"wrong version", -1, 8, 1},
+    };
+    for (const Corruption& c : corruptions)
+    {
+        copyFile(savedSketch, sketchFile, c.keepBytes);
+        if (c.offset >= 0)
+            overwriteWord(sketchFile, c.offset, c.word);
+        vector<CrawlResult> results = crawlAll(prefix, indicators, decided);
+        check(decided == 0, c.name + ": should fall back to exact checks");
+        compare(exact, results, c.name);
+    }
+
+    const char* suffixes[] = {".sourceToDestination", ".destinationToSource", ".prevalenceSketch", ".prevalenceSketch.saved"};
+    for (const char* suffix : suffixes)
+        remove((prefix + suffix).c_str());
+    remove(telemetryFile.c_str());
+
+    if (failures > 0)
+        return 1;
+    cout << "sketch_check: all checks passed (" << withSketch.size() << " crawls per variant)" << endl;
+    return 0;
+}
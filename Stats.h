@@ -0,0 +1,89 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <ostream>
+#include <cmath>
+
+//Instrumentation for DiskMultiMap and IntelWeb is on by default. Compiling with -DCYBERSPIDER_NO_STATS removes
+//every counter update from the hot paths; the stats() functions still exist but report zeros.
+#ifdef CYBERSPIDER_NO_STATS
+#define STATS_ONLY(...)
+#else
+#define STATS_ONLY(...) __VA_ARGS__
+#endif
+
+//Histogram with power of two buckets: bucket 0 counts zeros and bucket i counts values in [2^(i-1), 2^i).
+//Adding a value is a handful of instructions, so it is cheap enough to call on every operation.
+struct Histogram
+{
+    static const int numBuckets = 65;
+
+    Histogram()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        count = sum = max = 0;
+        for (int i = 0; i < numBuckets; i++)
+            buckets[i] = 0;
+    }
+
+    void add(unsigned long long value)
+    {
+        int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value); //number of bits needed to represent value, one instruction on GCC and Clang
+        buckets[bucket]++;
+        count++;
+        sum += value;
+        if (value > max)
+            max = value;
+    }
+
+    double mean() const
+    {
+        return count > 0 ? static_cast<double>(sum) / count : 0;
+    }
+
+    unsigned long long percentile(double p) const //upper bound of the bucket holding the nearest-rank p-th percentile, same rule as the benchmark
+    {
+        if (count == 0)
+            return 0;
+        double rank = std::ceil(p / 100 * count); //1-based rank of the smallest value with at least p percent of the samples at or below it
+        unsigned long long target = rank < 1 ? 1 : static_cast<unsigned long long>(rank);
+        unsigned long long seen = 0;
+        for (int i = 0; i < numBuckets; i++)
+        {
+            seen += buckets[i];
+            if (seen >= target)
+            {
+                unsigned long long upper = i == 0 ? 0 : (i >= 64 ? max : (1ULL << i) - 1);
+                return upper < max ? upper : max;
+            }
+        }
+        return max;
+    }
+
+    void writeJson(std::ostream& out) const //summary plus the non-empty buckets, keyed by their lower bound
+    {
+        out << "{\"count\":" << count << ",\"mean\":" << mean() << ",\"max\":" << max
+            << ",\"p50\":" << percentile(50) << ",\"p90\":" << percentile(90) << ",\"p99\":" << percentile(99)
+            << ",\"buckets\":{";
+        bool first = true;
+        for (int i = 0; i < numBuckets; i++)
+        {
+            if (buckets[i] == 0)
+                continue;
+            out << (first ? "" : ",") << "\"" << (i == 0 ? 0 : 1ULL << (i-1)) << "\":" << buckets[i];
+            first = false;
+        }
+        out << "}}";
+    }
+
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+    unsigned long long buckets[numBuckets];
+};
+
+#endif // STATS_H_
@@ -0,0 +1,95 @@
+#include "TelemetryGenerator.h"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+TelemetryGenerator::TelemetryGenerator(unsigned int numMachines, unsigned int numFiles, unsigned int numDomains, unsigned int seed, double skew)
+: m_rng(seed), m_numFiles(numFiles > 0 ? numFiles : 1), m_machines(numMachines, skew), m_files(numFiles, skew), m_domains(numDomains, skew)
+{
+    m_filePermutation.resize(m_numFiles);
+    for (unsigned int i = 0; i < m_numFiles; i++)
+        m_filePermutation[i] = i;
+    shuffle(m_filePermutation.begin(), m_filePermutation.end(), m_rng);
+}
+
+bool TelemetryGenerator::generate(const std::string& filename, unsigned int numLines)
+{
+    ofstream outf(filename);
+    if (!outf)
+        return false;
+    string machine, from, to;
+    for (unsigned int i = 0; i < numLines; i++)
+    {
+        nextLine(machine, from, to);
+        outf << machine << " " << from << " " << to << "\n";
+    }
+    return static_cast<bool>(outf);
+}
+
+void TelemetryGenerator::nextLine(std::string& machine, std::string& from, std::string& to)
+{
+    machine = machineName(m_machines(m_rng));
+    from = fileName(sampleFile());
+    //roughly 2 in 5 events are a file creating another file, the rest are a file downloaded from or contacting a website
+    bool createsFile = uniform_int_distribution<int>(0, 4)(m_rng) < 2;
+    if (createsFile)
+        to = fileName(sampleFile());
+    if (!createsFile || to == from) //a file creating itself is not a meaningful event, it contacts a website instead
+        to = domainName(m_domains(m_rng));
+}
+
+std::string TelemetryGenerator::randomFile()
+{
+    return fileName(uniform_int_distribution<unsigned int>(0, m_numFiles-1)(m_rng));
+}
+
+std::string TelemetryGenerator::machineName(unsigned int index) const
+{
+    return "m" + to_string(index);
+}
+
+std::string TelemetryGenerator::fileName(unsigned int index) const
+{
+    //a 40 hex digit name that looks like a SHA-1 file hash, derived from the index so the same index always gives the same name
+    mt19937_64 scramble(index);
+    char buffer[41];
+    unsigned long long a = scramble(), b = scramble(), c = scramble();
+    snprintf(buffer, sizeof(buffer), "%016llx%016llx%08llx", a, b, c & 0xffffffffULL);
+    return string(buffer) + ".exe";
+}
+
+std::string TelemetryGenerator::domainName(unsigned int index) const
+{
+    return "www.site" + to_string(index) + ".com";
+}
+
+unsigned int TelemetryGenerator::sampleFile()
+{
+    return m_filePermutation[m_files(m_rng)];
+}
+
+//ZipfDistribution implementation
+
+TelemetryGenerator::ZipfDistribution::ZipfDistribution(unsigned int n, double skew)
+{
+    if (n == 0)
+        n = 1;
+    m_cumulative.resize(n);
+    double total = 0;
+    for (unsigned int k = 0; k < n; k++) //running total of the weights, searched with a binary search when sampling
+    {
+        total += 1.0 / pow(k+1, skew);
+        m_cumulative[k] = total;
+    }
+}
+
+unsigned int TelemetryGenerator::ZipfDistribution::operator()(std::mt19937& rng)
+{
+    double target = uniform_real_distribution<double>(0, m_cumulative.back())(rng);
+    vector<double>::iterator it = upper_bound(m_cumulative.begin(), m_cumulative.end(), target);
+    if (it == m_cumulative.end()) //only possible through rounding at the very top of the range
+        --it;
+    return static_cast<unsigned int>(it - m_cumulative.begin());
+}
@@ -0,0 +1,42 @@
+#ifndef TELEMETRYGENERATOR_H_
+#define TELEMETRYGENERATOR_H_
+
+#include <string>
+#include <vector>
+#include <random>
+
+//Produces synthetic telemetry in the format IntelWeb::ingest reads ("machine from to" per line).
+//Machines, files and domains are each drawn from a power-law (Zipf) distribution, so a few entities
+//are very prevalent and most of them only appear a handful of times, like real crawl data.
+class TelemetryGenerator
+{
+public:
+    TelemetryGenerator(unsigned int numMachines, unsigned int numFiles, unsigned int numDomains, unsigned int seed, double skew = 1.1);
+    bool generate(const std::string& filename, unsigned int numLines);
+    void nextLine(std::string& machine, std::string& from, std::string& to);
+    std::string randomFile(); //uniformly chosen over all files, useful for picking crawl indicators with a mix of rare and prevalent entities
+
+    std::string machineName(unsigned int index) const;
+    std::string fileName(unsigned int index) const;
+    std::string domainName(unsigned int index) const;
+
+private:
+    //samples a rank in [0, n) where rank k is chosen with probability proportional to 1/(k+1)^skew
+    class ZipfDistribution
+    {
+    public:
+        ZipfDistribution(unsigned int n, double skew);
+        unsigned int operator()(std::mt19937& rng);
+    private:
+        std::vector<double> m_cumulative;
+    };
+
+    std::mt19937 m_rng;
+    unsigned int m_numFiles;
+    ZipfDistribution m_machines, m_files, m_domains;
+    std::vector<unsigned int> m_filePermutation; //scrambles ranks so the most prevalent files are not simply the lowest numbered ones
+
+    unsigned int sampleFile();
+};
+
+#endif // TELEMETRYGENERATOR_H_